@@ -22,6 +22,20 @@
 #else
 #include <unistd.h>
 #include <libgen.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined( __linux__ ) && defined( __GNUC__ ) && !defined( WINDOWS )
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION( 5, 6, 0 )
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define HAVE_IO_URING
+#endif
 #endif
 
 #include <stdio.h>
@@ -30,10 +44,51 @@
 #include <ctype.h>
 #include <math.h>
 
+#if defined( __STDC_VERSION__ ) && __STDC_VERSION__ >= 201112L && !defined( __STDC_NO_ATOMICS__ )
+#include <stdatomic.h>
+#define HAVE_ATOMICS
+#endif
+
 
 #define VALID_NUM_ARGS 5
 #define MIN_NUM_ARGS 2
 #define MAX_CHARS 2048
+#define MAX_SUGGESTIONS 5
+#define MAX_CHUNKS 64
+#define MIN_CHUNK_BYTES ( 1 << 20 )
+#define BATCH_CHUNK ( 256 * 1024 )
+#define BATCH_BUFFERS 4
+#define ENGINE_ANY 0
+#define ENGINE_BUFFERED 1
+#define ENGINE_THREADS 2
+#define ENGINE_URING 3
+#define CACHE_WAYS 8
+#define CACHE_KEY_CHARS 24
+
+/* The conversion cache is shared by the converting threads without a
+   lock. Compilers without C11 atomics (tcc, cl) get plain integers, the
+   cache then must only be used from one thread. */
+#ifdef HAVE_ATOMICS
+typedef atomic_uint Counter;
+#define COUNTER_LOAD( c ) atomic_load_explicit( ( c ), memory_order_acquire )
+#define COUNTER_STORE( c, v ) atomic_store_explicit( ( c ), ( v ), memory_order_release )
+#define COUNTER_ADD( c ) atomic_fetch_add_explicit( ( c ), 1, memory_order_relaxed )
+#define COUNTER_SWAP( c, e, v ) atomic_compare_exchange_strong( ( c ), ( e ), ( v ) )
+#define WORD_LOAD( c ) atomic_load_explicit( ( c ), memory_order_relaxed )
+#define WORD_STORE( c, v ) atomic_store_explicit( ( c ), ( v ), memory_order_relaxed )
+#define FENCE_ACQUIRE( ) atomic_thread_fence( memory_order_acquire )
+#define FENCE_RELEASE( ) atomic_thread_fence( memory_order_release )
+#else
+typedef unsigned int Counter;
+#define COUNTER_LOAD( c ) ( *( c ) )
+#define COUNTER_STORE( c, v ) ( *( c ) = ( v ) )
+#define COUNTER_ADD( c ) ( ( *( c ) )++ )
+#define COUNTER_SWAP( c, e, v ) ( *( c ) == *( e ) ? ( *( c ) = ( v ), 1 ) : ( *( e ) = *( c ), 0 ) )
+#define WORD_LOAD( c ) ( *( c ) )
+#define WORD_STORE( c, v ) ( *( c ) = ( v ) )
+#define FENCE_ACQUIRE( )
+#define FENCE_RELEASE( )
+#endif
 
 struct List{ int n; char **l; };
 
@@ -53,6 +108,67 @@ struct Database{
 	char **factor;
 	char **constant;
 	char **exponent;
+	int n_alias;
+	char **alias;
+	char **alias_unit;
+	unsigned int n_slots;
+	unsigned int n_parts;
+	int *slot;
+	unsigned int n_unit_slots;
+	int *unit_slot;
+	char *text;
+	size_t text_size;
+	char mapped;
+	struct BKNode *index;
+	char keep_index;
+	struct Cache *cache;
+};
+
+
+/* A line aligned piece of the database file, parsed by one thread into
+   its own rows. Line numbers count from the start of the chunk until
+   the chunks are merged. The rows point into the file text, which the
+   parser cuts into strings in place. */
+struct Chunk{
+	char *start;
+	char *end;
+	int id;
+	int n_lines;
+	int first_line;
+	int capacity;
+	struct Database db;
+	int *line;
+	unsigned int *hash;
+	unsigned int *unit_hash;
+	int offset;
+	int n_bad;
+	int *bad_line;
+	char **bad_text;
+	int n_dropped;
+	int *dropped;
+	struct Database *merged;
+	int *row_line;
+	struct Chunk *chunk;
+	int n_chunks;
+	void ( *work )( struct Chunk * );
+};
+
+
+/* Node of the BK-tree used to suggest units on a failed lookup. The
+   unit strings belong to the database, the tree only points to them. */
+struct BKNode{
+	char *unit;
+	int d;
+	struct BKNode *child;
+	struct BKNode *next;
+};
+
+
+struct Suggestions{
+	int len;
+	int n;
+	char *unit[ MAX_SUGGESTIONS ];
+	int d[ MAX_SUGGESTIONS ];
 };
 
 
@@ -62,22 +178,268 @@ struct Result{
 };
 
 
+/* A database row resolved to numbers: y = factor x^exponent + constant. */
+struct Transform{
+	double factor;
+	double constant;
+	double exponent;
+};
+
+
+/* The key and the answer of one cached conversion. */
+struct CacheData{
+	double qty;
+	char from_unit[ CACHE_KEY_CHARS ];
+	char to_unit[ CACHE_KEY_CHARS ];
+	float result;
+	char valid;
+};
+
+#define CACHE_WORDS ( ( sizeof( struct CacheData ) + sizeof( unsigned int ) - 1 ) / sizeof( unsigned int ) )
+
+union CacheCopy{
+	struct CacheData data;
+	unsigned int word[ CACHE_WORDS ];
+};
+
+
+/* One cached conversion. seq is odd while the entry is being written,
+   a reader that sees it change throws its copy away. The data is kept
+   as atomic words so a reader racing a writer only gets a stale copy. */
+struct CacheEntry{
+	Counter seq;
+	Counter ref;
+	Counter hash;
+	Counter word[ CACHE_WORDS ];
+};
+
+
+/* Entries are spread over independent shards, each one with its own
+   CLOCK hand and counters so threads hitting different shards do not
+   share any writes. */
+struct CacheShard{
+	Counter hand;
+	Counter hits;
+	Counter misses;
+	struct CacheEntry entry[ CACHE_WAYS ];
+};
+
+
+struct Cache{
+	unsigned int n_shards;
+	struct CacheShard *shard;
+	char skip_pow;
+};
+
+
+/* State of the conversion of one batch file. Input arrives in chunks
+   of any size, a line cut by the end of a chunk waits in carry. The
+   output goes to out; flush hands it over to the engine and must leave
+   an empty out behind. */
+struct Batch{
+	struct Database *db;
+	char carry[ MAX_CHARS ];
+	int carry_len;
+	char *out;
+	size_t out_len;
+	size_t out_cap;
+	void *engine;
+	void ( *flush )( struct Batch * );
+	void ( *line )( struct Batch *, char *, char * );
+	void *stage;
+	int failed;
+};
+
+
+/* Running aggregate of the time series window starting at start. With
+   an exponent of one the transform is affine, so the sums are kept in
+   the original units and only the results are converted. */
+struct Series{
+	struct Transform t;
+	char affine;
+	double seconds;
+	char open;
+	double start;
+	long n;
+	double sum;
+	double min;
+	double max;
+	long line;
+};
+
+
+#ifndef WINDOWS
+struct Slot{
+	char *data;
+	size_t len;
+};
+
+
+/* Bounded FIFO of buffers passed between the pipeline threads. */
+struct Queue{
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	int head;
+	int count;
+	struct Slot *slot[ BATCH_BUFFERS ];
+};
+
+
+/* Plain threaded pipeline: a reader, the converting thread and a
+   writer, turning buffers around through four queues. Each thread has
+   its own failure flag, read after the joins. */
+struct Pipeline{
+	int in;
+	int out;
+	char *memory;
+	struct Slot in_slot[ BATCH_BUFFERS ];
+	struct Slot out_slot[ BATCH_BUFFERS ];
+	struct Queue in_free;
+	struct Queue in_full;
+	struct Queue out_free;
+	struct Queue out_full;
+	struct Slot *current;
+	int read_failed;
+	int write_failed;
+};
+#endif
+
+
+#ifdef HAVE_IO_URING
+/* io_uring set up by hand, with BATCH_BUFFERS input and as many output
+   buffers registered with the kernel as fixed buffers. */
+struct Uring{
+	int fd;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	void *sq_ring;
+	void *cq_ring;
+	size_t sq_size;
+	size_t cq_size;
+	size_t sqe_size;
+	unsigned to_submit;
+	char *memory;
+	char broken;
+};
+
+
+/* One file going through the ring. Reads are issued ahead in file
+   order, converted in the same order, and the output buffers are
+   written at increasing offsets. The end of the file is the first read
+   returning nothing, the size is not trusted. */
+struct UringBatch{
+	struct Uring *ring;
+	int in;
+	int out;
+	char eof;
+	off_t read_offset;
+	off_t write_offset;
+	char in_state[ BATCH_BUFFERS ];
+	off_t in_offset[ BATCH_BUFFERS ];
+	size_t in_len[ BATCH_BUFFERS ];
+	char out_busy[ BATCH_BUFFERS ];
+	off_t out_offset[ BATCH_BUFFERS ];
+	size_t out_done[ BATCH_BUFFERS ];
+	size_t out_len[ BATCH_BUFFERS ];
+	int current;
+	int failed;
+	char spare[ MAX_CHARS ];
+};
+#endif
+
+
 void Help( );
 void License( );
 void ValidateCmd( int, const char ** );
 void InitializeData( struct Data * );
 void InitializeDatabase( struct Database * );
 void InitializeResult( struct Result * );
-void ResizeDatabase( struct Database * );
-void PrintConv( struct Data *, struct Result * );
+void ResizeDatabase( struct Database *, int );
+void AddAlias( struct Database *, char *, char * );
+int FindRow( struct Database *, const char *, const char * );
+unsigned int HashUnit( const char * );
+char *UnitName( struct Database *, int );
+unsigned int FindUnit( struct Database *, const char *, unsigned int );
+void InsertUnit( struct Database *, unsigned int, int );
+char *CanonicalUnit( struct Database *, char *, unsigned int * );
+char *ReadDatabaseFile( const char *, size_t *, char * );
+void InitializeChunk( struct Chunk *, char *, char *, struct Database * );
+int FindTokens( char *, char *, char **, int );
+void EndTokens( char **, int, char * );
+void ParseChunk( struct Chunk * );
+void CopyChunk( struct Chunk * );
+void IndexChunk( struct Chunk * );
+int CompareDropped( const void *, const void * );
+void RunChunks( struct Chunk *, int, void ( * )( struct Chunk * ) );
+void CleanChunk( struct Chunk * );
+char *ResolveUnit( struct Database *, char * );
+int EditDistance( const char *, const char * );
+void InsertBKNode( struct BKNode **, char * );
+int CompareSuggestion( struct Suggestions *, char *, int, char *, int );
+void AddSuggestion( struct Suggestions *, char *, int );
+void SearchBKNode( struct BKNode *, char *, int, struct Suggestions * );
+void ScanUnits( struct Database *, char *, int, struct Suggestions * );
+void CleanBKNode( struct BKNode * );
+void BuildSuggestionIndex( struct Database * );
+void Suggest( struct Database *, char *, struct Suggestions * );
+int FormatSuggestions( struct Database *, char *, char *, size_t );
+void PrintSuggestions( struct Database *, char * );
+int FormatConv( char *, size_t, struct Data *, struct Result * );
+void PrintConv( struct Database *, struct Data *, struct Result * );
 void ValidateData( struct Data * );
 void CleanData( struct Data * );
-void CleanList( struct List * );
 void CleanDatabase( struct Database * );
 void LoadDatabase( struct Database * );
 void Convert( struct Database *, struct Data *, struct Result * );
-struct List *Split( char *, char * );
-char *Strip( char * );
+int ResolveTransform( struct Database *, char *, char *, struct Transform * );
+double ApplyTransform( struct Transform *, double );
+void InitializeCache( struct Cache *, unsigned int, char );
+unsigned int HashUnits( const char *, const char * );
+unsigned int HashKey( double, const char *, const char * );
+int LookupCache( struct Cache *, double, const char *, const char *, struct Result * );
+void StoreCache( struct Cache *, double, const char *, const char *, struct Result * );
+void PrintCacheStats( struct Cache * );
+void CleanCache( struct Cache * );
+void InitializeBatch( struct Batch *, struct Database * );
+void ConvertLine( struct Batch *, char *, char * );
+void BatchInput( struct Batch *, char *, size_t );
+void BatchFinish( struct Batch * );
+void BatchPath( char *, const char * );
+void BufferedFlush( struct Batch * );
+int BatchBuffered( struct Database *, const char * );
+int Batch( struct Database *, int, int, const char ** );
+void EmitWindow( struct Batch * );
+void SeriesLine( struct Batch *, char *, char * );
+int Aggregate( struct Database *, double, char *, char * );
+#ifndef WINDOWS
+void InitializeQueue( struct Queue * );
+void QueuePut( struct Queue *, struct Slot * );
+struct Slot *QueueGet( struct Queue * );
+void CleanQueue( struct Queue * );
+void *PipelineReader( void * );
+void *PipelineWriter( void * );
+void PipelineFlush( struct Batch * );
+int CleanPipeline( struct Pipeline * );
+int BatchThreaded( struct Database *, const char * );
+#endif
+#ifdef HAVE_IO_URING
+int UringSetup( struct Uring *, unsigned );
+struct io_uring_sqe *UringSqe( struct Uring * );
+int UringEnter( struct Uring *, unsigned );
+void UringClose( struct Uring * );
+void UringRead( struct UringBatch *, int );
+void UringWrite( struct UringBatch *, int );
+int UringReap( struct UringBatch *, int );
+void UringFlush( struct Batch * );
+int BatchUring( struct Uring *, struct Database *, const char * );
+#endif
 void PrintList( struct List * );
 void GetInstallationPath( char * );
 
@@ -88,6 +450,70 @@ int main( int argc, const char **argv )
 	struct Database db;
 	struct Result r;
 
+	if ( argc == 6 && !strcmp( argv[1], "-w" ) && atof( argv[2] ) > 0 &&
+	     ( !strcmp( argv[4], "to" ) ||
+	       !strcmp( argv[4], "TO" ) ||
+	       !strcmp( argv[4], "To" ) ) ){
+		int status = 0;
+		InitializeDatabase( &db );
+		LoadDatabase( &db );
+		status = Aggregate( &db, atof( argv[2] ), ( char * ) argv[3], ( char * ) argv[5] );
+		CleanDatabase( &db );
+		return status;
+	}
+
+	if ( argc > 2 && !strcmp( argv[1], "-b" ) ){
+		struct Cache cache;
+		char stats = 0;
+		char skip_pow = 0;
+		int engine = ENGINE_ANY;
+		int first = 2;
+		int status = 0;
+		for ( ; first < argc && argv[ first ][ 0 ] == '-' && argv[ first ][ 1 ]; first ++ ){
+			if ( !strcmp( argv[ first ], "-s" ) ){
+				stats = 1;
+			}
+			else if ( !strcmp( argv[ first ], "-p" ) ){
+				skip_pow = 1;
+			}
+			else if ( !strcmp( argv[ first ], "-e" ) && first + 1 < argc ){
+				first ++;
+				if ( !strcmp( argv[ first ], "buffered" ) ){
+					engine = ENGINE_BUFFERED;
+				}
+				else if ( !strcmp( argv[ first ], "threads" ) ){
+					engine = ENGINE_THREADS;
+				}
+				else if ( !strcmp( argv[ first ], "uring" ) ){
+					engine = ENGINE_URING;
+				}
+				else{
+					Help();
+					exit( 1 );
+				}
+			}
+			else{
+				break;
+			}
+		}
+		if ( first == argc ){
+			Help();
+			exit( 1 );
+		}
+		InitializeDatabase( &db );
+		LoadDatabase( &db );
+		InitializeCache( &cache, 4096, skip_pow );
+		db.cache = &cache;
+		db.keep_index = 1;
+		status = Batch( &db, engine, argc - first, argv + first );
+		if ( stats ){
+			PrintCacheStats( &cache );
+		}
+		CleanCache( &cache );
+		CleanDatabase( &db );
+		return status;
+	}
+
 	ValidateCmd( argc, argv );
 	
 	InitializeData( &data );
@@ -104,7 +530,7 @@ int main( int argc, const char **argv )
 
 	Convert( &db, &data, &r );
 
-	PrintConv( &data, &r );
+	PrintConv( &db, &data, &r );
 
 	CleanData( &data );
 
@@ -154,6 +580,20 @@ void InitializeDatabase (struct Database *db )
 	db -> factor = NULL;
 	db -> constant = NULL;
 	db -> exponent = NULL;
+	db -> n_alias = 0;
+	db -> alias = NULL;
+	db -> alias_unit = NULL;
+	db -> n_slots = 0;
+	db -> n_parts = 1;
+	db -> slot = NULL;
+	db -> n_unit_slots = 0;
+	db -> unit_slot = NULL;
+	db -> text = NULL;
+	db -> text_size = 0;
+	db -> mapped = 0;
+	db -> index = NULL;
+	db -> keep_index = 0;
+	db -> cache = NULL;
 }
 
 void InitializeResult( struct Result *r )
@@ -162,28 +602,136 @@ void InitializeResult( struct Result *r )
 	r -> valid = 0;
 }
 
-void ResizeDatabase( struct Database *db )
+/* Makes room for size rows, db -> n is left to the caller. */
+void ResizeDatabase( struct Database *db, int size )
 {
 	char **temp_array = NULL;
 
-	db -> n += 1;
-
-	temp_array = realloc( db -> from_unit, db -> n * sizeof( char** ) );
+	temp_array = realloc( db -> from_unit, size * sizeof( char** ) );
 	db -> from_unit = temp_array;
 
-	temp_array = realloc( db -> to_unit, db -> n * sizeof( char** ) );
+	temp_array = realloc( db -> to_unit, size * sizeof( char** ) );
 	db -> to_unit = temp_array;
 
-	temp_array = realloc( db -> factor, db -> n * sizeof( char** ) );
+	temp_array = realloc( db -> factor, size * sizeof( char** ) );
 	db -> factor = temp_array;
 
-	temp_array = realloc( db -> constant, db -> n * sizeof( char** ) );
+	temp_array = realloc( db -> constant, size * sizeof( char** ) );
 	db -> constant = temp_array;
 
-	temp_array = realloc( db -> exponent, db -> n * sizeof( char** ) );
+	temp_array = realloc( db -> exponent, size * sizeof( char** ) );
 	db -> exponent = temp_array;
 }
 
+void AddAlias( struct Database *db, char *alias, char *unit )
+{
+	char **temp_array = NULL;
+
+	db -> n_alias += 1;
+
+	temp_array = realloc( db -> alias, db -> n_alias * sizeof( char** ) );
+	db -> alias = temp_array;
+
+	temp_array = realloc( db -> alias_unit, db -> n_alias * sizeof( char** ) );
+	db -> alias_unit = temp_array;
+
+	db -> alias[ db -> n_alias - 1 ] = strdup( alias );
+	db -> alias_unit[ db -> n_alias - 1 ] = strdup( unit );
+}
+
+/* Index of the row converting from_unit to to_unit, or -1. The slots
+   are split in n_parts equal partitions so each loader thread fills its
+   own, a probe wraps around inside the partition it starts in. */
+int FindRow( struct Database *db, const char *from_unit, const char *to_unit )
+{
+	unsigned int part_slots = db -> n_slots / db -> n_parts;
+	unsigned int s = 0;
+	unsigned int base = 0;
+
+	if ( !db -> n_slots ){
+		return -1;
+	}
+
+	s = HashUnits( from_unit, to_unit ) & ( db -> n_slots - 1 );
+	base = s & ~( part_slots - 1 );
+	while ( db -> slot[ s ] ){
+		int i = db -> slot[ s ] - 1;
+		if ( !strcmp( db -> from_unit[ i ], from_unit ) &&
+		     !strcmp( db -> to_unit[ i ], to_unit ) ){
+			return i;
+		}
+		s = base + ( ( s + 1 ) & ( part_slots - 1 ) );
+	}
+	return -1;
+}
+
+/* Every unit and alias spelling is in a second table of n_unit_slots,
+   partitioned like the rows. A slot holds 2 row + 1 for the from unit
+   of a row, 2 row + 2 for its to unit and -1 - i for alias i. */
+char *UnitName( struct Database *db, int v )
+{
+	if ( v < 0 ){
+		return db -> alias[ -v - 1 ];
+	}
+	return ( v - 1 ) & 1 ? db -> to_unit[ ( v - 1 ) / 2 ] : db -> from_unit[ ( v - 1 ) / 2 ];
+}
+
+/* The slot holding unit, or the empty slot where it would go. */
+unsigned int FindUnit( struct Database *db, const char *unit, unsigned int h )
+{
+	unsigned int part_slots = db -> n_unit_slots / db -> n_parts;
+	unsigned int s = h & ( db -> n_unit_slots - 1 );
+	unsigned int base = s & ~( part_slots - 1 );
+
+	while ( db -> unit_slot[ s ] && strcmp( UnitName( db, db -> unit_slot[ s ] ), unit ) ){
+		s = base + ( ( s + 1 ) & ( part_slots - 1 ) );
+	}
+	return s;
+}
+
+/* The first spelling seen is kept, later ones are the same string. */
+void InsertUnit( struct Database *db, unsigned int h, int v )
+{
+	unsigned int s = FindUnit( db, UnitName( db, v ), h );
+
+	if ( !db -> unit_slot[ s ] ){
+		db -> unit_slot[ s ] = v;
+	}
+}
+
+/* A unit of a row written under an alias becomes the unit the alias
+   stands for, so the lookup only has to deal with one spelling. h
+   comes in as the hash of unit and goes out as the hash of the result.
+   The aliases are in the unit table before any row. */
+char *CanonicalUnit( struct Database *db, char *unit, unsigned int *h )
+{
+	int v = db -> unit_slot[ FindUnit( db, unit, *h ) ];
+
+	if ( v >= 0 ){
+		return unit;
+	}
+	unit = db -> alias_unit[ -v - 1 ];
+	*h = HashUnit( unit );
+	return unit;
+}
+
+/* Returns the database spelling of a unit given on the command line, or
+   NULL if it is unknown. Case is never guessed: K and k, or M and m, are
+   different units, so other spellings must be declared as aliases. */
+char *ResolveUnit( struct Database *db, char *unit )
+{
+	int v = 0;
+
+	if ( !db -> n_unit_slots ){
+		return NULL;
+	}
+	v = db -> unit_slot[ FindUnit( db, unit, HashUnit( unit ) ) ];
+	if ( v < 0 ){
+		return db -> alias_unit[ -v - 1 ];
+	}
+	return v ? UnitName( db, v ) : NULL;
+}
+
 void ValidateData( struct Data *d )
 {
 	int i = 0;
@@ -233,166 +781,1971 @@ void GetInstallationPath( char *path )
 }
 
 
-void LoadDatabase( struct Database *db )
+/* Maps the database file, or reads it where it can not be mapped. The
+   text is always followed by one writable byte so the parser can end
+   the last string of a file with no final newline. */
+char *ReadDatabaseFile( const char *path, size_t *size, char *mapped )
 {
 	FILE *f = NULL;
-	char line[ MAX_CHARS ];
-	char final_path[ MAX_CHARS ];
-
-	GetInstallationPath( final_path );
-	
-	f = fopen( final_path, "r" );
-
-	if ( !f ){
-		printf( "Databasefile convdb.dat does not exist.\n" );
-		exit( 1 );
-	}
-
-	while( fgets( line, MAX_CHARS, f ) != NULL ){
-		if ( strstr( line, "#" ) ){
-			;
-		}
-		else if ( strlen( line ) > 7 ){
-			struct List *temp_line = NULL;
-			char *this_line = NULL;
-			this_line = Strip( line );
-			temp_line = Split( this_line, " " );
-			if ( temp_line -> n < 5 ){
-				printf( "Malformed database entry\n" );
-				printf( "%s", line );
-				printf( "Five (5) columns are needed:\n" );
-				printf( "Original Units | Target Units | Factor | Constant | Exponent\n" );
-				exit( 1 );
+	char *text = NULL;
+	long len = 0;
+
+	*mapped = 0;
+#ifndef WINDOWS
+	{
+		struct stat st;
+		int fd = open( path, O_RDONLY );
+		if ( fd < 0 ){
+			return NULL;
+		}
+		if ( !fstat( fd, &st ) && st.st_size > 0 ){
+			text = mmap( NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+			if ( text == MAP_FAILED ){
+				text = NULL;
+			}
+			else if ( text[ st.st_size - 1 ] != '\n' ){
+				munmap( text, st.st_size );
+				text = NULL;
 			}
-			ResizeDatabase( db );
-			db -> from_unit[ db -> n - 1 ] = strdup( temp_line -> l[0] );
-			db -> to_unit[ db -> n - 1 ] = strdup( temp_line -> l[1] );
-			db -> factor[ db -> n - 1 ] = strdup( temp_line -> l[2] );
-			db -> constant[ db -> n - 1 ] = strdup( temp_line -> l[3] );
-			db -> exponent[ db -> n - 1 ] = strdup( temp_line -> l[4] );
-			CleanList( temp_line );
-			free( this_line );
+			else{
+				*size = st.st_size;
+				*mapped = 1;
+			}
+		}
+		close( fd );
+		if ( text ){
+			return text;
 		}
 	}
+#endif
+	f = fopen( path, "rb" );
+	if ( !f ){
+		return NULL;
+	}
+	fseek( f, 0, SEEK_END );
+	len = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	text = malloc( len + 1 );
+	*size = fread( text, 1, len, f );
+	text[ *size ] = '\0';
 	fclose( f );
+	return text;
 }
 
+void InitializeChunk( struct Chunk *c, char *start, char *end, struct Database *merged )
+{
+	c -> start = start;
+	c -> end = end;
+	c -> id = 0;
+	c -> n_lines = 0;
+	c -> first_line = 0;
+	c -> capacity = 0;
+	InitializeDatabase( &c -> db );
+	c -> line = NULL;
+	c -> hash = NULL;
+	c -> unit_hash = NULL;
+	c -> offset = 0;
+	c -> n_bad = 0;
+	c -> bad_line = NULL;
+	c -> bad_text = NULL;
+	c -> n_dropped = 0;
+	c -> dropped = NULL;
+	c -> merged = merged;
+	c -> row_line = NULL;
+	c -> chunk = NULL;
+	c -> n_chunks = 0;
+	c -> work = NULL;
+}
 
-void Convert( struct Database *db, struct Data *d, struct Result *r )
+/* Counts the blank separated words of the line p..eol and keeps where
+   the first max of them start. The line is not modified. */
+int FindTokens( char *p, char *eol, char **token, int max )
 {
-	unsigned int i = 0;
-	for( i = 0; i < db -> n; i++ ){
-		if( !strcmp( db -> from_unit[i], d -> from_unit ) &&
-		    !strcmp( db -> to_unit[i], d -> to_unit ) ){
-			r -> result = pow( atof( d -> qty ), atof( db ->exponent[ i ] ) ) * atof( db -> factor[ i ] ) +
-				atof( db -> constant[ i ] );
-			r -> valid = 1;
-			return;
+	int n_token = 0;
+
+	while ( p < eol ){
+		while ( p < eol && isspace( ( unsigned char ) *p ) ){
+			p ++;
+		}
+		if ( p == eol ){
+			break;
+		}
+		if ( n_token < max ){
+			token[ n_token ] = p;
+		}
+		n_token ++;
+		while ( p < eol && !isspace( ( unsigned char ) *p ) ){
+			p ++;
 		}
 	}
+	return n_token;
 }
 
+/* Ends each of the n words found by FindTokens() with a '\0'. The byte
+   at eol may be overwritten. */
+void EndTokens( char **token, int n, char *eol )
+{
+	int i = 0;
 
-void PrintList( struct List *l )
+	for ( i = 0; i < n; i ++ ){
+		char *q = token[ i ];
+		while ( q < eol && !isspace( ( unsigned char ) *q ) ){
+			q ++;
+		}
+		*q = '\0';
+	}
+}
+
+/* Same rules as always: a line with a '#' is a comment, a row needs five
+   columns and an alias exactly three. Malformed lines are left untouched
+   and kept for the report. */
+void ParseChunk( struct Chunk *c )
 {
-	unsigned int i = 0;
-	for( i = 0; i < l -> n; i++ ){
-		printf( "%s", l -> l[i] );
+	char *p = c -> start;
+
+	while ( p < c -> end ){
+		char *eol = memchr( p, '\n', c -> end - p );
+		char *next = NULL;
+		char *token[ 5 ];
+		int n_token = 0;
+		int alias = 0;
+
+		if ( !eol ){
+			eol = c -> end;
+		}
+		next = eol + 1;
+		c -> n_lines += 1;
+
+		if ( memchr( p, '#', eol - p ) ){
+			p = next;
+			continue;
+		}
+
+		n_token = FindTokens( p, eol, token, 5 );
+
+		if ( n_token == 0 ){
+			p = next;
+			continue;
+		}
+
+		alias = !strncmp( token[ 0 ], "alias", 5 ) &&
+			isspace( ( unsigned char ) token[ 0 ][ 5 ] );
+		if ( alias ? n_token != 3 : n_token < 5 ){
+			c -> n_bad += 1;
+			c -> bad_line = realloc( c -> bad_line, c -> n_bad * sizeof( int ) );
+			c -> bad_text = realloc( c -> bad_text, c -> n_bad * sizeof( char * ) );
+			c -> bad_line[ c -> n_bad - 1 ] = c -> n_lines;
+			c -> bad_text[ c -> n_bad - 1 ] = p;
+			p = next;
+			continue;
+		}
+
+		EndTokens( token, n_token < 5 ? n_token : 5, eol );
+
+		if ( alias ){
+			AddAlias( &c -> db, token[ 1 ], token[ 2 ] );
+			p = next;
+			continue;
+		}
+
+		if ( c -> db.n == c -> capacity ){
+			c -> capacity = c -> capacity ? 2 * c -> capacity : 1024;
+			ResizeDatabase( &c -> db, c -> capacity );
+			c -> line = realloc( c -> line, c -> capacity * sizeof( int ) );
+		}
+		c -> db.from_unit[ c -> db.n ] = token[ 0 ];
+		c -> db.to_unit[ c -> db.n ] = token[ 1 ];
+		c -> db.factor[ c -> db.n ] = token[ 2 ];
+		c -> db.constant[ c -> db.n ] = token[ 3 ];
+		c -> db.exponent[ c -> db.n ] = token[ 4 ];
+		c -> line[ c -> db.n ] = c -> n_lines;
+		c -> db.n += 1;
+		p = next;
 	}
-	printf("\n");
 }
 
+/* Second pass, once the aliases of every chunk are known: the units
+   written under an alias are rewritten, then the rows and their units
+   are hashed and copied to their place in the merged database. */
+void CopyChunk( struct Chunk *c )
+{
+	struct Database *db = c -> merged;
+	int i = 0;
+
+	c -> hash = malloc( ( c -> db.n + 1 ) * sizeof( unsigned int ) );
+	c -> unit_hash = malloc( ( 2 * c -> db.n + 1 ) * sizeof( unsigned int ) );
+	for ( i = 0; i < c -> db.n; i ++ ){
+		c -> unit_hash[ 2 * i ] = HashUnit( c -> db.from_unit[ i ] );
+		c -> unit_hash[ 2 * i + 1 ] = HashUnit( c -> db.to_unit[ i ] );
+		c -> db.from_unit[ i ] = CanonicalUnit( db, c -> db.from_unit[ i ], &c -> unit_hash[ 2 * i ] );
+		c -> db.to_unit[ i ] = CanonicalUnit( db, c -> db.to_unit[ i ], &c -> unit_hash[ 2 * i + 1 ] );
+		c -> hash[ i ] = HashUnits( c -> db.from_unit[ i ], c -> db.to_unit[ i ] );
+		db -> from_unit[ c -> offset + i ] = c -> db.from_unit[ i ];
+		db -> to_unit[ c -> offset + i ] = c -> db.to_unit[ i ];
+		db -> factor[ c -> offset + i ] = c -> db.factor[ i ];
+		db -> constant[ c -> offset + i ] = c -> db.constant[ i ];
+		db -> exponent[ c -> offset + i ] = c -> db.exponent[ i ];
+		c -> row_line[ c -> offset + i ] = c -> first_line + c -> line[ i ];
+	}
+}
 
-void PrintConv( struct Data *d, struct Result *r )
+/* Third pass: the thread of chunk id indexes the rows of every chunk
+   falling in the partitions id, id + n_chunks, ... Rows are visited in
+   file order, so the first of two rows for the same units is the one
+   kept and the other one is recorded in dropped with the row it
+   repeats. The units of the rows go the same way into the unit table. */
+void IndexChunk( struct Chunk *c )
 {
-	if ( r -> valid ){
-		printf( "%.4f %s = %f %s\n", d -> q, d -> from_unit, r -> result, d -> to_unit );
+	struct Database *db = c -> merged;
+	unsigned int part_slots = db -> n_slots / db -> n_parts;
+	unsigned int unit_part_slots = db -> n_unit_slots / db -> n_parts;
+	int k = 0;
+	int j = 0;
+
+	for ( k = 0; k < c -> n_chunks; k ++ ){
+		struct Chunk *other = &c -> chunk[ k ];
+		for ( j = 0; j < other -> db.n; j ++ ){
+			unsigned int s = other -> hash[ j ] & ( db -> n_slots - 1 );
+			unsigned int base = s & ~( part_slots - 1 );
+			int row = other -> offset + j;
+
+			if ( ( s / part_slots ) % c -> n_chunks != c -> id ){
+				continue;
+			}
+			while ( db -> slot[ s ] ){
+				int first = db -> slot[ s ] - 1;
+				if ( !strcmp( db -> from_unit[ first ], db -> from_unit[ row ] ) &&
+				     !strcmp( db -> to_unit[ first ], db -> to_unit[ row ] ) ){
+					break;
+				}
+				s = base + ( ( s + 1 ) & ( part_slots - 1 ) );
+			}
+			if ( db -> slot[ s ] ){
+				c -> n_dropped += 1;
+				c -> dropped = realloc( c -> dropped, 2 * c -> n_dropped * sizeof( int ) );
+				c -> dropped[ 2 * c -> n_dropped - 2 ] = row;
+				c -> dropped[ 2 * c -> n_dropped - 1 ] = db -> slot[ s ] - 1;
+				continue;
+			}
+			db -> slot[ s ] = row + 1;
+		}
 	}
-	else{
-		printf( "Cannot convert from %s to %s.\n", d -> from_unit, d -> to_unit );
-		printf( "The units are not in the database.\n" );
+
+	for ( k = 0; k < c -> n_chunks; k ++ ){
+		struct Chunk *other = &c -> chunk[ k ];
+		for ( j = 0; j < 2 * other -> db.n; j ++ ){
+			unsigned int h = other -> unit_hash[ j ];
+			unsigned int s = h & ( db -> n_unit_slots - 1 );
+			if ( ( s / unit_part_slots ) % c -> n_chunks == c -> id ){
+				InsertUnit( db, h, 2 * other -> offset + j + 1 );
+			}
+		}
 	}
 }
 
-void CleanData( struct Data *d )
+int CompareDropped( const void *a, const void *b )
 {
-	free( d -> qty );
-	free( d -> from_unit );
-	free( d -> to_unit );
+	return *( const int * ) a - *( const int * ) b;
 }
 
-void CleanList( struct List *list )
+#ifndef WINDOWS
+void *ChunkThread( void *arg )
 {
-	int i = 0;
-	for( i = 0; i < list -> n; i++ ){
-		free( list -> l[ i ] );
-	}
-	free( list -> l );
-	free( list );
+	struct Chunk *c = arg;
+	c -> work( c );
+	return NULL;
 }
+#endif
 
-void CleanDatabase( struct Database *db )
+/* Runs work on every chunk, one thread per chunk where there are
+   threads. The calling thread takes the first chunk. */
+void RunChunks( struct Chunk *chunk, int n_chunks, void ( *work )( struct Chunk * ) )
 {
 	int i = 0;
-	for ( i = 0; i < db -> n; i ++ ){
-		free( db -> from_unit[ i ] );
-		free( db -> to_unit[ i ] );
-		free( db -> factor[ i ] );
-		free( db -> constant[ i ] );
-		free( db -> exponent[ i ] );
+#ifndef WINDOWS
+	pthread_t thread[ MAX_CHUNKS ];
+	char started[ MAX_CHUNKS ];
+
+	for ( i = 1; i < n_chunks; i ++ ){
+		chunk[ i ].work = work;
+		started[ i ] = !pthread_create( &thread[ i ], NULL, ChunkThread, &chunk[ i ] );
+		if ( !started[ i ] ){
+			work( &chunk[ i ] );
+		}
 	}
-	free( db -> from_unit );
-	free( db -> to_unit );
-	free( db -> factor );
-	free( db -> constant );
-	free( db -> exponent );
+	work( &chunk[ 0 ] );
+	for ( i = 1; i < n_chunks; i ++ ){
+		if ( started[ i ] ){
+			pthread_join( thread[ i ], NULL );
+		}
+	}
+#else
+	for ( i = 0; i < n_chunks; i ++ ){
+		work( &chunk[ i ] );
+	}
+#endif
 }
 
-char *Strip( char *s )
+/* The strings of the rows belong to the file text, only the arrays and
+   the aliases are the chunk's own. */
+void CleanChunk( struct Chunk *c )
 {
-	char *dup_s = strdup( s );
-	unsigned int len_dup_s = strlen( dup_s );
+	c -> db.n = 0;
+	CleanDatabase( &c -> db );
+	free( c -> line );
+	free( c -> hash );
+	free( c -> unit_hash );
+	free( c -> bad_line );
+	free( c -> bad_text );
+	free( c -> dropped );
+}
 
-	char *new_s = malloc( ( len_dup_s + 2 ) * sizeof( char ) );
-	unsigned int i = 0;
+/* The file is cut into line aligned chunks parsed in parallel, then
+   merged into one hash index on ( from, to ) and one on the unit names,
+   whose partitions are also filled in parallel. A repeated row is
+   reported and only the first one is indexed, as the lookup always did.
+   Malformed rows are reported with their line number and skipped. The
+   reports go to stderr, stdout only carries the answers. */
+void LoadDatabase( struct Database *db )
+{
+	char final_path[ MAX_CHARS ];
+	struct Chunk chunk[ MAX_CHUNKS ];
+	int n_chunks = 1;
+	int *row_line = NULL;
+	int *dropped = NULL;
+	int n_dropped = 0;
+	int n_bad = 0;
+	int i = 0;
+	int j = 0;
 
-	for ( i = 0; i < strlen( dup_s ); i ++ ){
-		if ( dup_s[ i ] == '\n' ){
-			new_s[ i ] = '\0';
-			break;
+	GetInstallationPath( final_path );
+
+	db -> text = ReadDatabaseFile( final_path, &db -> text_size, &db -> mapped );
+
+	if ( !db -> text ){
+		printf( "Databasefile convdb.dat does not exist.\n" );
+		exit( 1 );
+	}
+
+#ifndef WINDOWS
+	n_chunks = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+	if ( n_chunks > db -> text_size / MIN_CHUNK_BYTES ){
+		n_chunks = db -> text_size / MIN_CHUNK_BYTES;
+	}
+	if ( n_chunks > MAX_CHUNKS ){
+		n_chunks = MAX_CHUNKS;
+	}
+	if ( n_chunks < 1 ){
+		n_chunks = 1;
+	}
+
+	for ( i = 0; i < n_chunks; i ++ ){
+		char *start = i ? chunk[ i - 1 ].end : db -> text;
+		char *end = db -> text + db -> text_size;
+		if ( i < n_chunks - 1 ){
+			end = db -> text + ( db -> text_size / n_chunks ) * ( i + 1 );
+			if ( end < start ){
+				end = start;
+			}
+			end = memchr( end, '\n', db -> text + db -> text_size - end );
+			end = end ? end + 1 : db -> text + db -> text_size;
 		}
-		new_s[ i ] = dup_s[ i ];
+		InitializeChunk( &chunk[ i ], start, end, db );
+		chunk[ i ].id = i;
+		chunk[ i ].chunk = chunk;
+		chunk[ i ].n_chunks = n_chunks;
 	}
 
-	free( dup_s );
-	return new_s;
+	RunChunks( chunk, n_chunks, ParseChunk );
+
+	for ( i = 0; i < n_chunks; i ++ ){
+		for ( j = 0; j < chunk[ i ].db.n_alias; j ++ ){
+			AddAlias( db, chunk[ i ].db.alias[ j ], chunk[ i ].db.alias_unit[ j ] );
+		}
+		chunk[ i ].offset = db -> n;
+		chunk[ i ].first_line = i ? chunk[ i - 1 ].first_line + chunk[ i - 1 ].n_lines : 0;
+		db -> n += chunk[ i ].db.n;
+	}
+
+	ResizeDatabase( db, db -> n );
+	row_line = malloc( ( db -> n + 1 ) * sizeof( int ) );
+	for ( i = 0; i < n_chunks; i ++ ){
+		chunk[ i ].row_line = row_line;
+	}
+
+	while ( db -> n_parts < n_chunks ){
+		db -> n_parts <<= 1;
+	}
+	db -> n_unit_slots = 16 * db -> n_parts;
+	while ( db -> n_unit_slots < 2 * ( 2 * ( unsigned int ) db -> n + db -> n_alias ) ){
+		db -> n_unit_slots <<= 1;
+	}
+	db -> unit_slot = calloc( db -> n_unit_slots, sizeof( int ) );
+	for ( i = 0; i < db -> n_alias; i ++ ){
+		InsertUnit( db, HashUnit( db -> alias[ i ] ), -1 - i );
+	}
+
+	RunChunks( chunk, n_chunks, CopyChunk );
+
+	db -> n_slots = 16 * db -> n_parts;
+	while ( db -> n_slots < 2 * ( unsigned int ) db -> n ){
+		db -> n_slots <<= 1;
+	}
+	db -> slot = calloc( db -> n_slots, sizeof( int ) );
+
+	RunChunks( chunk, n_chunks, IndexChunk );
+
+	for ( i = 0; i < n_chunks; i ++ ){
+		struct Chunk *c = &chunk[ i ];
+		for ( j = 0; j < c -> n_bad; j ++ ){
+			char *eol = memchr( c -> bad_text[ j ], '\n', c -> end - c -> bad_text[ j ] );
+			int len = ( eol ? eol : c -> end ) - c -> bad_text[ j ];
+			fprintf( stderr, "Malformed database entry at line %d:\n", c -> first_line + c -> bad_line[ j ] );
+			fprintf( stderr, "%.*s\n", len, c -> bad_text[ j ] );
+			n_bad += 1;
+		}
+		dropped = realloc( dropped, 2 * ( n_dropped + c -> n_dropped + 1 ) * sizeof( int ) );
+		if ( c -> n_dropped ){
+			memcpy( dropped + 2 * n_dropped, c -> dropped, 2 * c -> n_dropped * sizeof( int ) );
+			n_dropped += c -> n_dropped;
+		}
+	}
+
+	if ( n_bad ){
+		fprintf( stderr, "Five (5) columns are needed:\n" );
+		fprintf( stderr, "Original Units | Target Units | Factor | Constant | Exponent\n" );
+		fprintf( stderr, "or three (3) columns for an alias:\n" );
+		fprintf( stderr, "alias | Name | Units\n" );
+	}
+
+	qsort( dropped, n_dropped, 2 * sizeof( int ), CompareDropped );
+	for ( i = 0; i < n_dropped; i ++ ){
+		int row = dropped[ 2 * i ];
+		int first = dropped[ 2 * i + 1 ];
+		if ( atof( db -> factor[ first ] ) == atof( db -> factor[ row ] ) &&
+		     atof( db -> constant[ first ] ) == atof( db -> constant[ row ] ) &&
+		     atof( db -> exponent[ first ] ) == atof( db -> exponent[ row ] ) ){
+			fprintf( stderr, "Duplicate database entry at line %d, same as line %d.\n",
+				row_line[ row ], row_line[ first ] );
+		}
+		else{
+			fprintf( stderr, "Conflicting database entry at line %d, line %d is used for %s to %s.\n",
+				row_line[ row ], row_line[ first ], db -> from_unit[ first ], db -> to_unit[ first ] );
+		}
+	}
+
+	for ( i = 0; i < n_chunks; i ++ ){
+		CleanChunk( &chunk[ i ] );
+	}
+	free( dropped );
+	free( row_line );
 }
 
-struct List *Split( char *s_a, char *del )
+
+void Convert( struct Database *db, struct Data *d, struct Result *r )
 {
-	char *pw = NULL;
-	char *temp_s_a = NULL;
-	char **temp_returned_list = NULL;
-	int word_len = 0;
+	double qty = atof( d -> qty );
+	struct Transform t;
+
+	if ( db -> cache && LookupCache( db -> cache, qty, d -> from_unit, d -> to_unit, r ) ){
+		return;
+	}
 
-	struct List *final_list = NULL;
-	final_list = malloc( sizeof( struct List ) );
-	final_list -> l = NULL;
-	final_list -> n = 0;
+	if ( ResolveTransform( db, d -> from_unit, d -> to_unit, &t ) ){
+		r -> result = ApplyTransform( &t, qty );
+		r -> valid = 1;
+		if ( db -> cache && !( db -> cache -> skip_pow && t.exponent != 1.0 ) ){
+			StoreCache( db -> cache, qty, d -> from_unit, d -> to_unit, r );
+		}
+		return;
+	}
 
-	temp_s_a = strdup( s_a );
-	pw = strtok( temp_s_a, del );
-	while( pw != NULL ){
-		temp_returned_list = realloc( final_list -> l,
-					      ( final_list -> n + 1 ) * sizeof( char ** ) );
-		final_list -> l = temp_returned_list;
-		word_len = strlen( pw );
-		final_list -> l[ final_list -> n ] = strdup( pw );
-		pw = strtok( NULL, del );
-		final_list -> n += 1;
+	if ( db -> cache ){
+		StoreCache( db -> cache, qty, d -> from_unit, d -> to_unit, r );
 	}
-	free( temp_s_a );
-	return final_list;
+}
+
+/* Looks the units up once for callers converting many values between
+   them. Returns 0 if there is no such conversion. */
+int ResolveTransform( struct Database *db, char *from, char *to, struct Transform *t )
+{
+	char *from_unit = ResolveUnit( db, from );
+	char *to_unit = ResolveUnit( db, to );
+	int i = 0;
+
+	if ( !from_unit || !to_unit ){
+		return 0;
+	}
+
+	i = FindRow( db, from_unit, to_unit );
+	if ( i < 0 ){
+		return 0;
+	}
+	t -> factor = atof( db -> factor[ i ] );
+	t -> constant = atof( db -> constant[ i ] );
+	t -> exponent = atof( db -> exponent[ i ] );
+	return 1;
+}
+
+double ApplyTransform( struct Transform *t, double x )
+{
+	return pow( x, t -> exponent ) * t -> factor + t -> constant;
+}
+
+
+/* n_shards is rounded up to a power of two. With skip_pow set the
+   conversions with an exponent other than one are never cached. */
+void InitializeCache( struct Cache *c, unsigned int n_shards, char skip_pow )
+{
+	c -> n_shards = 1;
+	while ( c -> n_shards < n_shards ){
+		c -> n_shards <<= 1;
+	}
+	c -> shard = calloc( c -> n_shards, sizeof( struct CacheShard ) );
+	c -> skip_pow = skip_pow;
+}
+
+/* FNV-1a over both unit names. */
+unsigned int HashUnits( const char *from_unit, const char *to_unit )
+{
+	unsigned int h = 2166136261u;
+	const unsigned char *p = NULL;
+
+	for ( p = ( const unsigned char * ) from_unit; *p; p ++ ){
+		h = ( h ^ *p ) * 16777619u;
+	}
+	h = ( h ^ 0xff ) * 16777619u;
+	for ( p = ( const unsigned char * ) to_unit; *p; p ++ ){
+		h = ( h ^ *p ) * 16777619u;
+	}
+	return h;
+}
+
+/* FNV-1a over one unit name. */
+unsigned int HashUnit( const char *unit )
+{
+	unsigned int h = 2166136261u;
+	const unsigned char *p = NULL;
+
+	for ( p = ( const unsigned char * ) unit; *p; p ++ ){
+		h = ( h ^ *p ) * 16777619u;
+	}
+	return h;
+}
+
+/* The same, continued over the quantity. */
+unsigned int HashKey( double qty, const char *from_unit, const char *to_unit )
+{
+	unsigned int h = HashUnits( from_unit, to_unit );
+	const unsigned char *p = ( const unsigned char * ) &qty;
+	unsigned int i = 0;
+
+	for ( i = 0; i < sizeof( double ); i ++ ){
+		h = ( h ^ p[ i ] ) * 16777619u;
+	}
+	return h;
+}
+
+int LookupCache( struct Cache *c, double qty, const char *from_unit, const char *to_unit, struct Result *r )
+{
+	unsigned int h = HashKey( qty, from_unit, to_unit );
+	struct CacheShard *shard = &c -> shard[ h & ( c -> n_shards - 1 ) ];
+	unsigned int i = 0;
+
+	for ( i = 0; i < CACHE_WAYS; i ++ ){
+		struct CacheEntry *e = &shard -> entry[ i ];
+		unsigned int seq = COUNTER_LOAD( &e -> seq );
+		union CacheCopy copy;
+		unsigned int w = 0;
+
+		if ( seq == 0 || ( seq & 1 ) || WORD_LOAD( &e -> hash ) != h ){
+			continue;
+		}
+		for ( w = 0; w < CACHE_WORDS; w ++ ){
+			copy.word[ w ] = WORD_LOAD( &e -> word[ w ] );
+		}
+		FENCE_ACQUIRE( );
+		if ( WORD_LOAD( &e -> seq ) != seq ){
+			continue;
+		}
+		if ( copy.data.qty == qty &&
+		     !strncmp( copy.data.from_unit, from_unit, CACHE_KEY_CHARS ) &&
+		     !strncmp( copy.data.to_unit, to_unit, CACHE_KEY_CHARS ) ){
+			COUNTER_STORE( &e -> ref, 1 );
+			COUNTER_ADD( &shard -> hits );
+			r -> result = copy.data.result;
+			r -> valid = copy.data.valid;
+			return 1;
+		}
+	}
+	COUNTER_ADD( &shard -> misses );
+	return 0;
+}
+
+/* Takes the first entry the CLOCK hand finds without its reference bit.
+   If another thread is writing that entry the result is simply not
+   cached, a writer never waits. */
+void StoreCache( struct Cache *c, double qty, const char *from_unit, const char *to_unit, struct Result *r )
+{
+	unsigned int h = 0;
+	struct CacheShard *shard = NULL;
+	struct CacheEntry *e = NULL;
+	union CacheCopy copy;
+	unsigned int seq = 0;
+	unsigned int i = 0;
+
+	if ( strlen( from_unit ) >= CACHE_KEY_CHARS || strlen( to_unit ) >= CACHE_KEY_CHARS ){
+		return;
+	}
+
+	h = HashKey( qty, from_unit, to_unit );
+	shard = &c -> shard[ h & ( c -> n_shards - 1 ) ];
+
+	for ( i = 0; i < 2 * CACHE_WAYS; i ++ ){
+		e = &shard -> entry[ COUNTER_ADD( &shard -> hand ) % CACHE_WAYS ];
+		if ( !COUNTER_LOAD( &e -> ref ) ){
+			break;
+		}
+		COUNTER_STORE( &e -> ref, 0 );
+	}
+
+	seq = COUNTER_LOAD( &e -> seq );
+	if ( ( seq & 1 ) || !COUNTER_SWAP( &e -> seq, &seq, seq + 1 ) ){
+		return;
+	}
+	FENCE_RELEASE( );
+	memset( &copy, 0, sizeof( copy ) );
+	copy.data.qty = qty;
+	memcpy( copy.data.from_unit, from_unit, strlen( from_unit ) + 1 );
+	memcpy( copy.data.to_unit, to_unit, strlen( to_unit ) + 1 );
+	copy.data.result = r -> result;
+	copy.data.valid = r -> valid;
+	WORD_STORE( &e -> hash, h );
+	for ( i = 0; i < CACHE_WORDS; i ++ ){
+		WORD_STORE( &e -> word[ i ], copy.word[ i ] );
+	}
+	COUNTER_STORE( &e -> ref, 1 );
+	COUNTER_STORE( &e -> seq, seq + 2 );
+}
+
+/* On stderr, so it never mixes with the answers. */
+void PrintCacheStats( struct Cache *c )
+{
+	unsigned long hits = 0;
+	unsigned long misses = 0;
+	unsigned int i = 0;
+
+	for ( i = 0; i < c -> n_shards; i ++ ){
+		hits += COUNTER_LOAD( &c -> shard[ i ].hits );
+		misses += COUNTER_LOAD( &c -> shard[ i ].misses );
+	}
+	fprintf( stderr, "Cache: %lu hits, %lu misses, hit rate %.1f%%\n", hits, misses,
+		hits + misses ? 100.0 * hits / ( hits + misses ) : 0.0 );
+}
+
+void CleanCache( struct Cache *c )
+{
+	free( c -> shard );
+	c -> shard = NULL;
+	c -> n_shards = 0;
+}
+
+
+void InitializeBatch( struct Batch *b, struct Database *db )
+{
+	b -> db = db;
+	b -> carry_len = 0;
+	b -> out = NULL;
+	b -> out_len = 0;
+	b -> out_cap = 0;
+	b -> engine = NULL;
+	b -> flush = NULL;
+	b -> line = ConvertLine;
+	b -> stage = NULL;
+	b -> failed = 0;
+}
+
+/* A batch line is QTY FROM_UNIT TO TO_UNIT, the TO being optional, and
+   gets the same answer line the command line prints, with the
+   suggestions for an unknown unit on the same line. Blank lines and
+   lines with a '#' are skipped. */
+void ConvertLine( struct Batch *b, char *p, char *eol )
+{
+	char line[ MAX_CHARS ];
+	char *token[ 4 ];
+	char *end = NULL;
+	char *out = NULL;
+	int n_token = 0;
+	int len = 0;
+	struct Data d;
+	struct Result r;
+
+	if ( eol - p >= MAX_CHARS ){
+		eol = p + MAX_CHARS - 1;
+	}
+	memcpy( line, p, eol - p );
+	line[ eol - p ] = '\0';
+	eol = line + ( eol - p );
+
+	if ( strchr( line, '#' ) ){
+		return;
+	}
+	n_token = FindTokens( line, eol, token, 4 );
+	if ( n_token == 0 ){
+		return;
+	}
+
+	if ( b -> out_cap - b -> out_len < MAX_CHARS ){
+		b -> flush( b );
+	}
+
+	EndTokens( token, n_token < 4 ? n_token : 4, eol );
+	if ( n_token == 4 && strcmp( token[ 2 ], "to" ) &&
+	     strcmp( token[ 2 ], "TO" ) && strcmp( token[ 2 ], "To" ) ){
+		n_token = 0;
+	}
+	if ( n_token != 3 && n_token != 4 ){
+		b -> out_len += sprintf( b -> out + b -> out_len, "Malformed batch entry\n" );
+		return;
+	}
+
+	InitializeData( &d );
+	InitializeResult( &r );
+	d.qty = token[ 0 ];
+	d.from_unit = token[ 1 ];
+	d.to_unit = token[ n_token - 1 ];
+	d.q = strtod( d.qty, &end );
+	if ( end == d.qty || *end ){
+		b -> out_len += sprintf( b -> out + b -> out_len,
+					 "The quantity provided is not valid\n" );
+		return;
+	}
+
+	Convert( b -> db, &d, &r );
+	out = b -> out + b -> out_len;
+	len = FormatConv( out, MAX_CHARS, &d, &r );
+	if ( !r.valid ){
+		len -= 1;
+		if ( !ResolveUnit( b -> db, d.from_unit ) && len < MAX_CHARS - 2 ){
+			out[ len ++ ] = ' ';
+			len += FormatSuggestions( b -> db, d.from_unit, out + len, MAX_CHARS - 1 - len );
+		}
+		if ( !ResolveUnit( b -> db, d.to_unit ) && len < MAX_CHARS - 2 ){
+			out[ len ++ ] = ' ';
+			len += FormatSuggestions( b -> db, d.to_unit, out + len, MAX_CHARS - 1 - len );
+		}
+		out[ len ++ ] = '\n';
+	}
+	b -> out_len += len;
+}
+
+void BatchInput( struct Batch *b, char *data, size_t n )
+{
+	char *p = data;
+	char *end = data + n;
+
+	while ( p < end && !b -> failed ){
+		char *eol = memchr( p, '\n', end - p );
+		if ( !eol ){
+			size_t rest = end - p;
+			if ( rest > MAX_CHARS - 1 - b -> carry_len ){
+				rest = MAX_CHARS - 1 - b -> carry_len;
+			}
+			memcpy( b -> carry + b -> carry_len, p, rest );
+			b -> carry_len += rest;
+			return;
+		}
+		if ( b -> carry_len ){
+			size_t rest = eol - p;
+			if ( rest > MAX_CHARS - 1 - b -> carry_len ){
+				rest = MAX_CHARS - 1 - b -> carry_len;
+			}
+			memcpy( b -> carry + b -> carry_len, p, rest );
+			b -> line( b, b -> carry, b -> carry + b -> carry_len + rest );
+			b -> carry_len = 0;
+		}
+		else{
+			b -> line( b, p, eol );
+		}
+		p = eol + 1;
+	}
+}
+
+/* Converts a last line with no newline and hands over what is left. */
+void BatchFinish( struct Batch *b )
+{
+	if ( b -> carry_len && !b -> failed ){
+		b -> line( b, b -> carry, b -> carry + b -> carry_len );
+		b -> carry_len = 0;
+	}
+	if ( b -> out_len ){
+		b -> flush( b );
+	}
+}
+
+/* The answers for FILE go to FILE.conv. */
+void BatchPath( char *path, const char *file )
+{
+#ifdef WINDOWS
+	_snprintf( path, MAX_CHARS, "%s.conv", file );
+#else
+	snprintf( path, MAX_CHARS, "%s.conv", file );
+#endif
+}
+
+void BufferedFlush( struct Batch *b )
+{
+	if ( fwrite( b -> out, 1, b -> out_len, b -> engine ) != b -> out_len ){
+		b -> failed = 1;
+	}
+	b -> out_len = 0;
+}
+
+/* The simple way: read, convert and write one after the other. */
+int BatchBuffered( struct Database *db, const char *file )
+{
+	char path[ MAX_CHARS ];
+	struct Batch b;
+	FILE *in = NULL;
+	char *data = NULL;
+	size_t n = 0;
+
+	BatchPath( path, file );
+	in = fopen( file, "rb" );
+	if ( !in ){
+		printf( "Cannot open %s.\n", file );
+		return 1;
+	}
+
+	InitializeBatch( &b, db );
+	b.engine = fopen( path, "wb" );
+	if ( !b.engine ){
+		printf( "Cannot open %s.\n", path );
+		fclose( in );
+		return 1;
+	}
+	data = malloc( 2 * BATCH_CHUNK );
+	b.out = data + BATCH_CHUNK;
+	b.out_cap = BATCH_CHUNK;
+	b.flush = BufferedFlush;
+
+	while ( ( n = fread( data, 1, BATCH_CHUNK, in ) ) > 0 ){
+		BatchInput( &b, data, n );
+	}
+	BatchFinish( &b );
+
+	if ( ferror( in ) ){
+		b.failed = 1;
+	}
+	fclose( in );
+	if ( fclose( b.engine ) ){
+		b.failed = 1;
+	}
+	free( data );
+	if ( b.failed ){
+		printf( "Batch conversion of %s failed.\n", file );
+	}
+	return b.failed;
+}
+
+
+/* Writes the closed window as START N MEAN MIN MAX in the target
+   units. A negative factor turns the smallest value into the largest. */
+void EmitWindow( struct Batch *b )
+{
+	struct Series *ts = b -> stage;
+	double mean = 0.0;
+	double min = 0.0;
+	double max = 0.0;
+	int len = 0;
+
+	if ( !ts -> open ){
+		return;
+	}
+	mean = ts -> sum / ts -> n;
+	min = ts -> min;
+	max = ts -> max;
+	if ( ts -> affine ){
+		mean = ApplyTransform( &ts -> t, mean );
+		min = ApplyTransform( &ts -> t, ts -> min );
+		max = ApplyTransform( &ts -> t, ts -> max );
+		if ( ts -> t.factor < 0 ){
+			double swap = min;
+			min = max;
+			max = swap;
+		}
+	}
+
+	if ( b -> out_cap - b -> out_len < MAX_CHARS ){
+		b -> flush( b );
+	}
+	len = snprintf( b -> out + b -> out_len, MAX_CHARS, "%.3f %ld %f %f %f\n",
+			ts -> start, ts -> n, mean, min, max );
+	if ( len < 0 || len >= MAX_CHARS ){
+		len = MAX_CHARS - 1;
+		b -> out[ b -> out_len + len - 1 ] = '\n';
+	}
+	b -> out_len += len;
+	ts -> open = 0;
+}
+
+/* A series line is TIME VALUE, TIME in seconds. The lines must come in
+   time order: a later sample outside the open window closes it, an
+   earlier one is reported and skipped. */
+void SeriesLine( struct Batch *b, char *p, char *eol )
+{
+	struct Series *ts = b -> stage;
+	char line[ MAX_CHARS ];
+	char *token[ 2 ];
+	char *end = NULL;
+	int n = 0;
+	double time = 0.0;
+	double value = 0.0;
+	double start = 0.0;
+
+	ts -> line += 1;
+	if ( eol - p >= MAX_CHARS ){
+		eol = p + MAX_CHARS - 1;
+	}
+	memcpy( line, p, eol - p );
+	line[ eol - p ] = '\0';
+	eol = line + ( eol - p );
+
+	n = FindTokens( line, eol, token, 2 );
+	if ( n == 0 || token[ 0 ][ 0 ] == '#' ){
+		return;
+	}
+	if ( n != 2 ){
+		fprintf( stderr, "Malformed series entry at line %ld\n", ts -> line );
+		return;
+	}
+	EndTokens( token, 2, eol );
+	time = strtod( token[ 0 ], &end );
+	if ( end == token[ 0 ] || *end ){
+		fprintf( stderr, "Malformed series entry at line %ld\n", ts -> line );
+		return;
+	}
+	value = strtod( token[ 1 ], &end );
+	if ( end == token[ 1 ] || *end ){
+		fprintf( stderr, "Malformed series entry at line %ld\n", ts -> line );
+		return;
+	}
+
+	if ( ts -> open && time < ts -> start ){
+		fprintf( stderr, "Out of order series entry at line %ld\n", ts -> line );
+		return;
+	}
+
+	if ( !ts -> affine ){
+		value = ApplyTransform( &ts -> t, value );
+	}
+
+	start = floor( time / ts -> seconds ) * ts -> seconds;
+	if ( ts -> open && start != ts -> start ){
+		EmitWindow( b );
+	}
+	if ( !ts -> open ){
+		ts -> open = 1;
+		ts -> start = start;
+		ts -> n = 0;
+		ts -> sum = 0.0;
+		ts -> min = value;
+		ts -> max = value;
+	}
+	ts -> n += 1;
+	ts -> sum += value;
+	if ( value < ts -> min ){
+		ts -> min = value;
+	}
+	if ( value > ts -> max ){
+		ts -> max = value;
+	}
+}
+
+/* conv -w: reads TIME VALUE lines in from_unit on the standard input
+   and writes the count, mean, min and max in to_unit of every window of
+   the given seconds. One pass, whatever the length of the input. */
+int Aggregate( struct Database *db, double seconds, char *from_unit, char *to_unit )
+{
+	struct Series ts;
+	struct Batch b;
+	char *data = NULL;
+	size_t n = 0;
+
+	if ( !ResolveTransform( db, from_unit, to_unit, &ts.t ) ){
+		struct Data d;
+		struct Result r;
+		InitializeData( &d );
+		InitializeResult( &r );
+		d.from_unit = from_unit;
+		d.to_unit = to_unit;
+		PrintConv( db, &d, &r );
+		return 1;
+	}
+	ts.affine = ts.t.exponent == 1.0;
+	ts.seconds = seconds;
+	ts.open = 0;
+	ts.start = 0.0;
+	ts.n = 0;
+	ts.sum = 0.0;
+	ts.min = 0.0;
+	ts.max = 0.0;
+	ts.line = 0;
+
+	InitializeBatch( &b, db );
+	b.engine = stdout;
+	b.flush = BufferedFlush;
+	b.line = SeriesLine;
+	b.stage = &ts;
+	data = malloc( 2 * BATCH_CHUNK );
+	b.out = data + BATCH_CHUNK;
+	b.out_cap = BATCH_CHUNK;
+
+	while ( ( n = fread( data, 1, BATCH_CHUNK, stdin ) ) > 0 ){
+		BatchInput( &b, data, n );
+	}
+	BatchFinish( &b );
+	EmitWindow( &b );
+	if ( b.out_len ){
+		b.flush( &b );
+	}
+	fflush( stdout );
+
+	free( data );
+	return b.failed;
+}
+
+
+#ifndef WINDOWS
+void InitializeQueue( struct Queue *q )
+{
+	pthread_mutex_init( &q -> lock, NULL );
+	pthread_cond_init( &q -> changed, NULL );
+	q -> head = 0;
+	q -> count = 0;
+}
+
+void QueuePut( struct Queue *q, struct Slot *s )
+{
+	pthread_mutex_lock( &q -> lock );
+	while ( q -> count == BATCH_BUFFERS ){
+		pthread_cond_wait( &q -> changed, &q -> lock );
+	}
+	q -> slot[ ( q -> head + q -> count ) % BATCH_BUFFERS ] = s;
+	q -> count += 1;
+	pthread_cond_broadcast( &q -> changed );
+	pthread_mutex_unlock( &q -> lock );
+}
+
+struct Slot *QueueGet( struct Queue *q )
+{
+	struct Slot *s = NULL;
+
+	pthread_mutex_lock( &q -> lock );
+	while ( q -> count == 0 ){
+		pthread_cond_wait( &q -> changed, &q -> lock );
+	}
+	s = q -> slot[ q -> head ];
+	q -> head = ( q -> head + 1 ) % BATCH_BUFFERS;
+	q -> count -= 1;
+	pthread_cond_broadcast( &q -> changed );
+	pthread_mutex_unlock( &q -> lock );
+	return s;
+}
+
+void CleanQueue( struct Queue *q )
+{
+	pthread_mutex_destroy( &q -> lock );
+	pthread_cond_destroy( &q -> changed );
+}
+
+/* Fills free input buffers until the end of the file, which is passed
+   on as an empty buffer. */
+void *PipelineReader( void *arg )
+{
+	struct Pipeline *pl = arg;
+
+	for ( ;; ){
+		struct Slot *s = QueueGet( &pl -> in_free );
+		ssize_t n = 0;
+		s -> len = 0;
+		while ( s -> len < BATCH_CHUNK &&
+			( n = read( pl -> in, s -> data + s -> len, BATCH_CHUNK - s -> len ) ) > 0 ){
+			s -> len += n;
+		}
+		if ( n < 0 ){
+			pl -> read_failed = 1;
+			s -> len = 0;
+		}
+		QueuePut( &pl -> in_full, s );
+		if ( s -> len == 0 ){
+			return NULL;
+		}
+	}
+}
+
+/* Writes the full output buffers until it gets an empty one. */
+void *PipelineWriter( void *arg )
+{
+	struct Pipeline *pl = arg;
+
+	for ( ;; ){
+		struct Slot *s = QueueGet( &pl -> out_full );
+		size_t done = 0;
+		if ( s -> len == 0 ){
+			return NULL;
+		}
+		while ( done < s -> len ){
+			ssize_t n = write( pl -> out, s -> data + done, s -> len - done );
+			if ( n <= 0 ){
+				pl -> write_failed = 1;
+				break;
+			}
+			done += n;
+		}
+		QueuePut( &pl -> out_free, s );
+	}
+}
+
+void PipelineFlush( struct Batch *b )
+{
+	struct Pipeline *pl = b -> engine;
+
+	pl -> current -> len = b -> out_len;
+	QueuePut( &pl -> out_full, pl -> current );
+	pl -> current = QueueGet( &pl -> out_free );
+	b -> out = pl -> current -> data;
+	b -> out_len = 0;
+}
+
+/* Reading, converting and writing overlap in three threads. Used when
+   io_uring is not there. */
+/* Releases the queues and the buffers and closes the files. Returns
+   non zero if the output could not be closed. */
+int CleanPipeline( struct Pipeline *pl )
+{
+	CleanQueue( &pl -> in_free );
+	CleanQueue( &pl -> in_full );
+	CleanQueue( &pl -> out_free );
+	CleanQueue( &pl -> out_full );
+	free( pl -> memory );
+	close( pl -> in );
+	return close( pl -> out );
+}
+
+/* The writer is started first: if the reader then can not be, the
+   writer is simply told to finish. Without threads the file goes
+   through BatchBuffered() instead. */
+int BatchThreaded( struct Database *db, const char *file )
+{
+	char path[ MAX_CHARS ];
+	struct Pipeline pl;
+	struct Batch b;
+	pthread_t reader;
+	pthread_t writer;
+	int failed = 0;
+	int i = 0;
+
+	BatchPath( path, file );
+	pl.in = open( file, O_RDONLY );
+	if ( pl.in < 0 ){
+		printf( "Cannot open %s.\n", file );
+		return 1;
+	}
+	pl.out = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if ( pl.out < 0 ){
+		printf( "Cannot open %s.\n", path );
+		close( pl.in );
+		return 1;
+	}
+	pl.read_failed = 0;
+	pl.write_failed = 0;
+	pl.memory = malloc( 2 * BATCH_BUFFERS * BATCH_CHUNK );
+	InitializeQueue( &pl.in_free );
+	InitializeQueue( &pl.in_full );
+	InitializeQueue( &pl.out_free );
+	InitializeQueue( &pl.out_full );
+	for ( i = 0; i < BATCH_BUFFERS; i ++ ){
+		pl.in_slot[ i ].data = pl.memory + i * BATCH_CHUNK;
+		pl.out_slot[ i ].data = pl.memory + ( BATCH_BUFFERS + i ) * BATCH_CHUNK;
+		QueuePut( &pl.in_free, &pl.in_slot[ i ] );
+		QueuePut( &pl.out_free, &pl.out_slot[ i ] );
+	}
+
+	InitializeBatch( &b, db );
+	b.engine = &pl;
+	b.flush = PipelineFlush;
+	pl.current = QueueGet( &pl.out_free );
+	b.out = pl.current -> data;
+	b.out_cap = BATCH_CHUNK;
+
+	if ( pthread_create( &writer, NULL, PipelineWriter, &pl ) ){
+		CleanPipeline( &pl );
+		return BatchBuffered( db, file );
+	}
+	if ( pthread_create( &reader, NULL, PipelineReader, &pl ) ){
+		pl.current -> len = 0;
+		QueuePut( &pl.out_full, pl.current );
+		pthread_join( writer, NULL );
+		CleanPipeline( &pl );
+		return BatchBuffered( db, file );
+	}
+
+	for ( ;; ){
+		struct Slot *s = QueueGet( &pl.in_full );
+		if ( s -> len == 0 ){
+			break;
+		}
+		BatchInput( &b, s -> data, s -> len );
+		QueuePut( &pl.in_free, s );
+	}
+	BatchFinish( &b );
+
+	pl.current -> len = 0;
+	QueuePut( &pl.out_full, pl.current );
+	pthread_join( reader, NULL );
+	pthread_join( writer, NULL );
+
+	failed = pl.read_failed || pl.write_failed;
+	if ( CleanPipeline( &pl ) ){
+		failed = 1;
+	}
+	if ( failed ){
+		printf( "Batch conversion of %s failed.\n", file );
+	}
+	return failed;
+}
+#endif
+
+
+#ifdef HAVE_IO_URING
+/* Returns 0 on success. Any failure, a kernel without io_uring or one
+   that forbids it, leaves the ring unusable and the caller falls back
+   to the threaded pipeline. */
+int UringSetup( struct Uring *u, unsigned entries )
+{
+	struct io_uring_params p;
+	struct iovec iov[ 2 * BATCH_BUFFERS ];
+	int i = 0;
+
+	memset( &p, 0, sizeof( p ) );
+	memset( u, 0, sizeof( struct Uring ) );
+	u -> fd = syscall( __NR_io_uring_setup, entries, &p );
+	if ( u -> fd < 0 ){
+		return 1;
+	}
+
+	u -> sq_size = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+	u -> cq_size = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ){
+		if ( u -> cq_size > u -> sq_size ){
+			u -> sq_size = u -> cq_size;
+		}
+		u -> cq_size = u -> sq_size;
+	}
+	u -> sq_ring = mmap( NULL, u -> sq_size, PROT_READ | PROT_WRITE,
+			     MAP_SHARED, u -> fd, IORING_OFF_SQ_RING );
+	if ( u -> sq_ring == MAP_FAILED ){
+		close( u -> fd );
+		return 1;
+	}
+	if ( p.features & IORING_FEAT_SINGLE_MMAP ){
+		u -> cq_ring = u -> sq_ring;
+	}
+	else{
+		u -> cq_ring = mmap( NULL, u -> cq_size, PROT_READ | PROT_WRITE,
+				     MAP_SHARED, u -> fd, IORING_OFF_CQ_RING );
+		if ( u -> cq_ring == MAP_FAILED ){
+			munmap( u -> sq_ring, u -> sq_size );
+			close( u -> fd );
+			return 1;
+		}
+	}
+	u -> sqe_size = p.sq_entries * sizeof( struct io_uring_sqe );
+	u -> sqe = mmap( NULL, u -> sqe_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED, u -> fd, IORING_OFF_SQES );
+	if ( u -> sqe == MAP_FAILED ){
+		u -> sqe = NULL;
+		UringClose( u );
+		return 1;
+	}
+
+	u -> sq_head = ( unsigned * )( ( char * ) u -> sq_ring + p.sq_off.head );
+	u -> sq_tail = ( unsigned * )( ( char * ) u -> sq_ring + p.sq_off.tail );
+	u -> sq_mask = ( unsigned * )( ( char * ) u -> sq_ring + p.sq_off.ring_mask );
+	u -> sq_array = ( unsigned * )( ( char * ) u -> sq_ring + p.sq_off.array );
+	u -> cq_head = ( unsigned * )( ( char * ) u -> cq_ring + p.cq_off.head );
+	u -> cq_tail = ( unsigned * )( ( char * ) u -> cq_ring + p.cq_off.tail );
+	u -> cq_mask = ( unsigned * )( ( char * ) u -> cq_ring + p.cq_off.ring_mask );
+	u -> cqe = ( struct io_uring_cqe * )( ( char * ) u -> cq_ring + p.cq_off.cqes );
+
+	u -> memory = malloc( 2 * BATCH_BUFFERS * BATCH_CHUNK );
+	for ( i = 0; i < 2 * BATCH_BUFFERS; i ++ ){
+		iov[ i ].iov_base = u -> memory + i * BATCH_CHUNK;
+		iov[ i ].iov_len = BATCH_CHUNK;
+	}
+	if ( syscall( __NR_io_uring_register, u -> fd, IORING_REGISTER_BUFFERS,
+		      iov, 2 * BATCH_BUFFERS ) < 0 ){
+		UringClose( u );
+		return 1;
+	}
+	return 0;
+}
+
+/* The ring has room for every buffer, so an entry is always free. */
+struct io_uring_sqe *UringSqe( struct Uring *u )
+{
+	unsigned tail = *u -> sq_tail;
+	unsigned index = tail & *u -> sq_mask;
+	struct io_uring_sqe *sqe = &u -> sqe[ index ];
+
+	memset( sqe, 0, sizeof( struct io_uring_sqe ) );
+	u -> sq_array[ index ] = index;
+	__atomic_store_n( u -> sq_tail, tail + 1, __ATOMIC_RELEASE );
+	u -> to_submit += 1;
+	return sqe;
+}
+
+/* Submits the new entries and waits for wait completions. */
+int UringEnter( struct Uring *u, unsigned wait )
+{
+	int n = syscall( __NR_io_uring_enter, u -> fd, u -> to_submit, wait,
+			 wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0 );
+	if ( n < 0 ){
+		return -1;
+	}
+	u -> to_submit -= n;
+	return 0;
+}
+
+/* A ring left with I/O in flight keeps its buffers, the kernel may
+   still be using them. */
+void UringClose( struct Uring *u )
+{
+	if ( u -> sqe ){
+		munmap( u -> sqe, u -> sqe_size );
+	}
+	if ( u -> cq_ring && u -> cq_ring != u -> sq_ring ){
+		munmap( u -> cq_ring, u -> cq_size );
+	}
+	munmap( u -> sq_ring, u -> sq_size );
+	close( u -> fd );
+	if ( !u -> broken ){
+		free( u -> memory );
+	}
+}
+
+/* Input buffer i reads the next piece of the file. Buffer user data is
+   its index, output buffers are offset by BATCH_BUFFERS. */
+void UringRead( struct UringBatch *ub, int i )
+{
+	struct io_uring_sqe *sqe = NULL;
+
+	if ( ub -> eof ){
+		ub -> in_state[ i ] = 2;
+		ub -> in_len[ i ] = 0;
+		return;
+	}
+	ub -> in_state[ i ] = 1;
+	ub -> in_offset[ i ] = ub -> read_offset;
+	ub -> in_len[ i ] = 0;
+	ub -> read_offset += BATCH_CHUNK;
+
+	sqe = UringSqe( ub -> ring );
+	sqe -> opcode = IORING_OP_READ_FIXED;
+	sqe -> fd = ub -> in;
+	sqe -> addr = ( unsigned long ) ( ub -> ring -> memory + i * BATCH_CHUNK );
+	sqe -> len = BATCH_CHUNK;
+	sqe -> off = ub -> in_offset[ i ];
+	sqe -> buf_index = i;
+	sqe -> user_data = i;
+}
+
+/* Writes what is left of output buffer i. */
+void UringWrite( struct UringBatch *ub, int i )
+{
+	struct io_uring_sqe *sqe = UringSqe( ub -> ring );
+	char *data = ub -> ring -> memory + ( BATCH_BUFFERS + i ) * BATCH_CHUNK;
+
+	ub -> out_busy[ i ] = 1;
+	sqe -> opcode = IORING_OP_WRITE_FIXED;
+	sqe -> fd = ub -> out;
+	sqe -> addr = ( unsigned long ) ( data + ub -> out_done[ i ] );
+	sqe -> len = ub -> out_len[ i ] - ub -> out_done[ i ];
+	sqe -> off = ub -> out_offset[ i ] + ub -> out_done[ i ];
+	sqe -> buf_index = BATCH_BUFFERS + i;
+	sqe -> user_data = BATCH_BUFFERS + i;
+}
+
+/* Submits what is queued, waits for at least wait completions and
+   handles all the completions there are. A short read or write is
+   issued again for the rest, until a read returns 0. */
+int UringReap( struct UringBatch *ub, int wait )
+{
+	struct Uring *u = ub -> ring;
+	unsigned head = 0;
+
+	if ( UringEnter( u, wait ) ){
+		ub -> failed = 1;
+		return -1;
+	}
+
+	head = *u -> cq_head;
+	while ( head != __atomic_load_n( u -> cq_tail, __ATOMIC_ACQUIRE ) ){
+		struct io_uring_cqe *cqe = &u -> cqe[ head & *u -> cq_mask ];
+		int i = cqe -> user_data;
+		int res = cqe -> res;
+		head ++;
+
+		if ( res < 0 ){
+			ub -> failed = 1;
+			if ( i < BATCH_BUFFERS ){
+				ub -> in_state[ i ] = 2;
+			}
+			else{
+				ub -> out_busy[ i - BATCH_BUFFERS ] = 0;
+			}
+			continue;
+		}
+		if ( i < BATCH_BUFFERS ){
+			ub -> in_len[ i ] += res;
+			if ( res == 0 ){
+				ub -> eof = 1;
+			}
+			if ( res > 0 && ub -> in_len[ i ] < BATCH_CHUNK ){
+				struct io_uring_sqe *sqe = UringSqe( u );
+				sqe -> opcode = IORING_OP_READ_FIXED;
+				sqe -> fd = ub -> in;
+				sqe -> addr = ( unsigned long ) ( u -> memory + i * BATCH_CHUNK + ub -> in_len[ i ] );
+				sqe -> len = BATCH_CHUNK - ub -> in_len[ i ];
+				sqe -> off = ub -> in_offset[ i ] + ub -> in_len[ i ];
+				sqe -> buf_index = i;
+				sqe -> user_data = i;
+			}
+			else{
+				ub -> in_state[ i ] = 2;
+			}
+		}
+		else{
+			i -= BATCH_BUFFERS;
+			ub -> out_done[ i ] += res;
+			if ( res > 0 && ub -> out_done[ i ] < ub -> out_len[ i ] ){
+				UringWrite( ub, i );
+			}
+			else{
+				if ( res == 0 ){
+					ub -> failed = 1;
+				}
+				ub -> out_busy[ i ] = 0;
+			}
+		}
+	}
+	__atomic_store_n( u -> cq_head, head, __ATOMIC_RELEASE );
+	return 0;
+}
+
+/* Queues the full output buffer for writing and takes the next one,
+   waiting for its previous write to finish if needed. Once the ring
+   has failed no buffer is handed out again, the kernel may still be
+   reading them: the line being converted goes to spare and is dropped,
+   and BatchInput stops. */
+void UringFlush( struct Batch *b )
+{
+	struct UringBatch *ub = b -> engine;
+	int i = ub -> current;
+
+	if ( ub -> failed ){
+		b -> failed = 1;
+		b -> out = ub -> spare;
+		b -> out_cap = MAX_CHARS;
+		b -> out_len = 0;
+		return;
+	}
+
+	ub -> out_len[ i ] = b -> out_len;
+	ub -> out_done[ i ] = 0;
+	ub -> out_offset[ i ] = ub -> write_offset;
+	ub -> write_offset += b -> out_len;
+	UringWrite( ub, i );
+
+	i = ( i + 1 ) % BATCH_BUFFERS;
+	while ( ub -> out_busy[ i ] && !ub -> failed ){
+		UringReap( ub, 1 );
+	}
+	if ( ub -> failed ){
+		UringFlush( b );
+		return;
+	}
+	UringEnter( ub -> ring, 0 );
+	ub -> current = i;
+	b -> out = ub -> ring -> memory + ( BATCH_BUFFERS + i ) * BATCH_CHUNK;
+	b -> out_len = 0;
+}
+
+/* While one input buffer is converted the next ones are being read and
+   the previous output buffers written, all in the kernel's hands. */
+int BatchUring( struct Uring *u, struct Database *db, const char *file )
+{
+	char path[ MAX_CHARS ];
+	struct UringBatch ub;
+	struct Batch b;
+	int i = 0;
+	int busy = 1;
+
+	memset( &ub, 0, sizeof( ub ) );
+	ub.ring = u;
+	BatchPath( path, file );
+	ub.in = open( file, O_RDONLY );
+	if ( ub.in < 0 ){
+		printf( "Cannot open %s.\n", file );
+		return 1;
+	}
+	ub.out = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if ( ub.out < 0 ){
+		printf( "Cannot open %s.\n", path );
+		close( ub.in );
+		return 1;
+	}
+
+	InitializeBatch( &b, db );
+	b.engine = &ub;
+	b.flush = UringFlush;
+	b.out = u -> memory + BATCH_BUFFERS * BATCH_CHUNK;
+	b.out_cap = BATCH_CHUNK;
+
+	for ( i = 0; i < BATCH_BUFFERS; i ++ ){
+		UringRead( &ub, i );
+	}
+
+	for ( i = 0; !ub.failed; i = ( i + 1 ) % BATCH_BUFFERS ){
+		while ( ub.in_state[ i ] != 2 ){
+			if ( UringReap( &ub, 1 ) ){
+				break;
+			}
+		}
+		if ( ub.failed || ub.in_len[ i ] == 0 ){
+			break;
+		}
+		BatchInput( &b, u -> memory + i * BATCH_CHUNK, ub.in_len[ i ] );
+		UringRead( &ub, i );
+		UringEnter( u, 0 );
+	}
+	if ( !ub.failed ){
+		BatchFinish( &b );
+	}
+
+	/* Waits for every read and write still in flight. */
+	while ( busy ){
+		busy = 0;
+		for ( i = 0; i < BATCH_BUFFERS; i ++ ){
+			if ( ub.in_state[ i ] == 1 || ub.out_busy[ i ] ){
+				busy = 1;
+			}
+		}
+		if ( busy && UringReap( &ub, 1 ) ){
+			u -> broken = 1;
+			break;
+		}
+	}
+
+	close( ub.in );
+	if ( close( ub.out ) ){
+		ub.failed = 1;
+	}
+	if ( ub.failed || b.failed ){
+		printf( "Batch conversion of %s failed.\n", file );
+		return 1;
+	}
+	return 0;
+}
+#endif
+
+/* Converts every file given with -b with the engine asked for, or by
+   default with the best one there is: io_uring, else the threaded
+   pipeline, else plain buffered I/O. Pipes and other files that are not
+   regular never go to io_uring, whose reads are issued ahead at fixed
+   offsets. An engine that is not available here falls back the same
+   way. */
+int Batch( struct Database *db, int engine, int n_files, const char **files )
+{
+	int status = 0;
+	int i = 0;
+#ifdef HAVE_IO_URING
+	struct Uring u;
+	struct stat st;
+	int uring = 0;
+
+	if ( engine == ENGINE_ANY || engine == ENGINE_URING ){
+		uring = !UringSetup( &u, 4 * BATCH_BUFFERS );
+	}
+#else
+	int uring = 0;
+#endif
+
+	if ( engine == ENGINE_URING && !uring ){
+		fprintf( stderr, "io_uring is not available, using the default engine.\n" );
+	}
+
+	for ( i = 0; i < n_files; i ++ ){
+		if ( engine == ENGINE_BUFFERED ){
+			status |= BatchBuffered( db, files[ i ] );
+			continue;
+		}
+#ifdef HAVE_IO_URING
+		if ( uring && !stat( files[ i ], &st ) && S_ISREG( st.st_mode ) ){
+			status |= BatchUring( &u, db, files[ i ] );
+			if ( u.broken ){
+				UringClose( &u );
+				uring = 0;
+			}
+			continue;
+		}
+#endif
+#ifndef WINDOWS
+		status |= BatchThreaded( db, files[ i ] );
+#else
+		status |= BatchBuffered( db, files[ i ] );
+#endif
+	}
+
+#ifdef HAVE_IO_URING
+	if ( uring ){
+		UringClose( &u );
+	}
+#endif
+	return status;
+}
+
+
+void PrintList( struct List *l )
+{
+	unsigned int i = 0;
+	for( i = 0; i < l -> n; i++ ){
+		printf( "%s", l -> l[i] );
+	}
+	printf("\n");
+}
+
+
+/* Case insensitive Levenshtein distance, computed on a single row. */
+int EditDistance( const char *a, const char *b )
+{
+	int row[ MAX_CHARS + 1 ];
+	int len_a = strlen( a );
+	int len_b = strlen( b );
+	int i = 0;
+	int j = 0;
+
+	if ( len_b > MAX_CHARS ){
+		len_b = MAX_CHARS;
+	}
+
+	for ( j = 0; j <= len_b; j ++ ){
+		row[ j ] = j;
+	}
+	for ( i = 1; i <= len_a; i ++ ){
+		int diagonal = row[ 0 ];
+		row[ 0 ] = i;
+		for ( j = 1; j <= len_b; j ++ ){
+			int above = row[ j ];
+			int best = diagonal +
+				( tolower( ( unsigned char ) a[ i - 1 ] ) != tolower( ( unsigned char ) b[ j - 1 ] ) );
+			if ( above + 1 < best ){
+				best = above + 1;
+			}
+			if ( row[ j - 1 ] + 1 < best ){
+				best = row[ j - 1 ] + 1;
+			}
+			row[ j ] = best;
+			diagonal = above;
+		}
+	}
+	return row[ len_b ];
+}
+
+void InsertBKNode( struct BKNode **root, char *unit )
+{
+	struct BKNode *node = *root;
+	struct BKNode *new_node = NULL;
+
+	while ( node ){
+		struct BKNode *c = NULL;
+		int d = EditDistance( node -> unit, unit );
+		if ( d == 0 && !strcmp( node -> unit, unit ) ){
+			return;
+		}
+		for ( c = node -> child; c; c = c -> next ){
+			if ( c -> d == d ){
+				break;
+			}
+		}
+		if ( !c ){
+			new_node = malloc( sizeof( struct BKNode ) );
+			new_node -> unit = unit;
+			new_node -> d = d;
+			new_node -> child = NULL;
+			new_node -> next = node -> child;
+			node -> child = new_node;
+			return;
+		}
+		node = c;
+	}
+
+	new_node = malloc( sizeof( struct BKNode ) );
+	new_node -> unit = unit;
+	new_node -> d = 0;
+	new_node -> child = NULL;
+	new_node -> next = NULL;
+	*root = new_node;
+}
+
+/* Orders suggestions by distance, then by how far their length is from
+   the unit asked for, then by name, so the tree and the scan give the
+   same answer. */
+int CompareSuggestion( struct Suggestions *s, char *a, int d_a, char *b, int d_b )
+{
+	int len_a = abs( ( int ) strlen( a ) - s -> len );
+	int len_b = abs( ( int ) strlen( b ) - s -> len );
+
+	if ( d_a != d_b ){
+		return d_a - d_b;
+	}
+	if ( len_a != len_b ){
+		return len_a - len_b;
+	}
+	return strcmp( a, b );
+}
+
+void AddSuggestion( struct Suggestions *s, char *unit, int d )
+{
+	int i = 0;
+
+	if ( s -> n == MAX_SUGGESTIONS &&
+	     CompareSuggestion( s, unit, d, s -> unit[ s -> n - 1 ], s -> d[ s -> n - 1 ] ) >= 0 ){
+		return;
+	}
+	i = s -> n < MAX_SUGGESTIONS ? s -> n ++ : s -> n - 1;
+	while ( i > 0 && CompareSuggestion( s, s -> unit[ i - 1 ], s -> d[ i - 1 ], unit, d ) > 0 ){
+		s -> unit[ i ] = s -> unit[ i - 1 ];
+		s -> d[ i ] = s -> d[ i - 1 ];
+		i --;
+	}
+	s -> unit[ i ] = unit;
+	s -> d[ i ] = d;
+}
+
+/* Collects the closest units within max_d of unit. Only the children
+   whose edge lies within max_d of the distance to this node can hold a
+   match. */
+void SearchBKNode( struct BKNode *node, char *unit, int max_d, struct Suggestions *s )
+{
+	struct BKNode *c = NULL;
+	int d = 0;
+
+	if ( !node ){
+		return;
+	}
+
+	d = EditDistance( node -> unit, unit );
+	if ( d <= max_d ){
+		AddSuggestion( s, node -> unit, d );
+	}
+
+	for ( c = node -> child; c; c = c -> next ){
+		if ( s -> n == MAX_SUGGESTIONS && s -> d[ s -> n - 1 ] < max_d ){
+			max_d = s -> d[ s -> n - 1 ];
+		}
+		if ( c -> d >= d - max_d && c -> d <= d + max_d ){
+			SearchBKNode( c, unit, max_d, s );
+		}
+	}
+}
+
+/* The same search over the unit table, for a caller that misses once:
+   building the tree would cost far more than one pass. Names whose
+   length alone puts them too far are not compared. */
+void ScanUnits( struct Database *db, char *unit, int max_d, struct Suggestions *s )
+{
+	int len = strlen( unit );
+	unsigned int i = 0;
+
+	for ( i = 0; i < db -> n_unit_slots; i ++ ){
+		char *name = NULL;
+		int diff = 0;
+		int d = 0;
+
+		if ( !db -> unit_slot[ i ] ){
+			continue;
+		}
+		name = UnitName( db, db -> unit_slot[ i ] );
+		diff = ( int ) strlen( name ) - len;
+		if ( diff > max_d || -diff > max_d ){
+			continue;
+		}
+		d = EditDistance( name, unit );
+		if ( d <= max_d ){
+			AddSuggestion( s, name, d );
+			if ( s -> n == MAX_SUGGESTIONS && s -> d[ s -> n - 1 ] < max_d ){
+				max_d = s -> d[ s -> n - 1 ];
+			}
+		}
+	}
+}
+
+void CleanBKNode( struct BKNode *node )
+{
+	while ( node ){
+		struct BKNode *next = node -> next;
+		CleanBKNode( node -> child );
+		free( node );
+		node = next;
+	}
+}
+
+/* Each unit and alias spelling once, in file order: only the place the
+   unit table points to is inserted. */
+void BuildSuggestionIndex( struct Database *db )
+{
+	int i = 0;
+	for ( i = 1; i <= 2 * db -> n; i ++ ){
+		char *unit = UnitName( db, i );
+		if ( db -> unit_slot[ FindUnit( db, unit, HashUnit( unit ) ) ] == i ){
+			InsertBKNode( &db -> index, unit );
+		}
+	}
+	for ( i = 0; i < db -> n_alias; i ++ ){
+		InsertBKNode( &db -> index, db -> alias[ i ] );
+	}
+}
+
+/* The tree is only built for a database with keep_index set, by the
+   callers that may miss many times, and then on the first miss. */
+void Suggest( struct Database *db, char *unit, struct Suggestions *s )
+{
+	int max_d = strlen( unit ) > 2 ? 2 : 1;
+
+	s -> len = strlen( unit );
+	s -> n = 0;
+	if ( !db -> keep_index ){
+		ScanUnits( db, unit, max_d, s );
+		return;
+	}
+	if ( !db -> index ){
+		BuildSuggestionIndex( db );
+	}
+	SearchBKNode( db -> index, unit, max_d, s );
+}
+
+/* Writes "Unknown unit UNIT." and the suggestions, if any, into s, at
+   most n chars and with no newline. */
+int FormatSuggestions( struct Database *db, char *unit, char *s, size_t n )
+{
+	struct Suggestions sg;
+	int len = 0;
+	int i = 0;
+
+	Suggest( db, unit, &sg );
+	len = snprintf( s, n, sg.n ? "Unknown unit %s. Did you mean:" : "Unknown unit %s.", unit );
+	for ( i = 0; i < sg.n && len >= 0 && len < ( int ) n; i ++ ){
+		len += snprintf( s + len, n - len, " %s", sg.unit[ i ] );
+	}
+	if ( len < 0 || len >= ( int ) n ){
+		len = n - 1;
+		s[ len ] = '\0';
+	}
+	return len;
+}
+
+void PrintSuggestions( struct Database *db, char *unit )
+{
+	char line[ MAX_CHARS ];
+
+	FormatSuggestions( db, unit, line, MAX_CHARS );
+	printf( "%s\n", line );
+}
+
+/* Writes the answer line for a conversion into s, at most n chars. */
+int FormatConv( char *s, size_t n, struct Data *d, struct Result *r )
+{
+	int len = 0;
+#ifdef WINDOWS
+	if ( r -> valid ){
+		len = _snprintf( s, n, "%.4f %s = %f %s\n", d -> q, d -> from_unit, r -> result, d -> to_unit );
+	}
+	else{
+		len = _snprintf( s, n, "Cannot convert from %s to %s.\n", d -> from_unit, d -> to_unit );
+	}
+#else
+	if ( r -> valid ){
+		len = snprintf( s, n, "%.4f %s = %f %s\n", d -> q, d -> from_unit, r -> result, d -> to_unit );
+	}
+	else{
+		len = snprintf( s, n, "Cannot convert from %s to %s.\n", d -> from_unit, d -> to_unit );
+	}
+#endif
+	if ( len < 0 || len >= ( int ) n ){
+		len = n - 1;
+		s[ len - 1 ] = '\n';
+		s[ len ] = '\0';
+	}
+	return len;
+}
+
+void PrintConv( struct Database *db, struct Data *d, struct Result *r )
+{
+	char line[ MAX_CHARS ];
+
+	FormatConv( line, MAX_CHARS, d, r );
+	printf( "%s", line );
+
+	if ( !r -> valid ){
+		char *from_unit = ResolveUnit( db, d -> from_unit );
+		char *to_unit = ResolveUnit( db, d -> to_unit );
+		if ( !from_unit ){
+			PrintSuggestions( db, d -> from_unit );
+		}
+		if ( !to_unit ){
+			PrintSuggestions( db, d -> to_unit );
+		}
+		if ( from_unit && to_unit ){
+			printf( "The units are not in the database.\n" );
+		}
+	}
+}
+
+void CleanData( struct Data *d )
+{
+	free( d -> qty );
+	free( d -> from_unit );
+	free( d -> to_unit );
+}
+
+/* The row strings point into db -> text, they are released with it. */
+void CleanDatabase( struct Database *db )
+{
+	int i = 0;
+	free( db -> from_unit );
+	free( db -> to_unit );
+	free( db -> factor );
+	free( db -> constant );
+	free( db -> exponent );
+	for ( i = 0; i < db -> n_alias; i ++ ){
+		free( db -> alias[ i ] );
+		free( db -> alias_unit[ i ] );
+	}
+	free( db -> alias );
+	free( db -> alias_unit );
+	free( db -> slot );
+	free( db -> unit_slot );
+#ifndef WINDOWS
+	if ( db -> mapped ){
+		munmap( db -> text, db -> text_size );
+	}
+	else
+#endif
+	free( db -> text );
+	CleanBKNode( db -> index );
 }
 
 void Help()
@@ -413,6 +2766,18 @@ void Help()
 		"       $ conv 2 m to km <enter>\n\n"
 		"  output:\n"
 		"       $ 2.0000 m = 0.002000 km\n\n"
+		"BATCH:\n"
+		"  conv -b [ -s ] [ -p ] [ -e ENGINE ] [ FILE ] ... <enter>\n\n"
+		"  Each line of FILE is QTY FROM_UNIT TO TO_UNIT. The answers\n"
+		"  are written, one line each, to FILE.conv\n"
+		"  -s  print the hit rate of the conversion cache\n"
+		"  -p  do not cache conversions with an exponent other than 1\n"
+		"  -e  uring, threads or buffered instead of the best there is\n\n"
+		"TIME SERIES:\n"
+		"  conv -w [ SECONDS ] [ FROM_UNIT ] TO [ TO_UNIT ] <enter>\n\n"
+		"  Reads TIME VALUE lines, TIME in seconds and in order, and\n"
+		"  writes START COUNT MEAN MIN MAX in TO_UNIT for every window\n"
+		"  of SECONDS.\n\n"
 		"LICENSE INFO:\n"
 		"  -l --license\n\n"
 		"  conv is 2015 (c) Jaime Ortiz\n\n"